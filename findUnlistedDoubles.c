@@ -4,6 +4,15 @@
 //   -> Within dMv mv of each other.
 //   -> Not within XXX" of a WDS pair.
 // An HTML format list of unlisted pairs will be created.
+//
+// Usage: findUnlistedDoubles [shard nShards]
+//        findUnlistedDoubles merge nShards
+// Given a shard, only that shard's candidates from mkUCAC4_Regions are
+// searched, and the pairs found are saved with a manifest in the shard's
+// directory. Once every shard is done, merge checks the manifests and combines
+// the shards' pairs, without duplicates, into the usual HTML list.
+// Square degrees compressed by mkUCAC4_Regions -z are read as well as plain
+// ones, and the decoding speed is reported at the end.
 
 #include <errno.h>
 #include <math.h>
@@ -15,7 +24,6 @@
 const double pi = 3.14159265358979323846;
 
 FILE *CAN,    // The stars that might be a new pair's primary.
-     *MGN,    // A zone near the margin of the current zone.
      *SQUARE; // The square degree files that stars are stored in.
 
 // UCAC4 magnitudes are expressed in thousandth of a magnitude.
@@ -33,13 +41,19 @@ int dMv = 4000,   // The maximum magnitude difference between the two stars.
 int wdsCt = 0,  //TEST
     wdsOut = 0; //TEST
 
+int shard = 0,   // This process' shard, 0 to nShards - 1.
+    nShards = 1; // The number of shards. 1 is a whole sky run.
+
+// The holding directory. Shards each get their own subdirectory.
+char tmpDir[32] = "/science/tmp/";
+
 // Stars within a box of XXX arc seconds centered on the primary candidate will
 // be considered as companions of the candidate.
 const double XXX = 3.14159265358979323846 / (180 * 60 * 2); // 30" in radians.
 
 // Store this data from a given Candidate entry.
 typedef struct Candidate_Data {
-  char deg[24];// The square degree a candidate is located in.
+  char deg[48];// The square degree a candidate is located in.
   double ra;   // Right ascension in radians.
   double dec;  // Declination in radians.
   int dFlg;    // UCAC4 double flag.
@@ -74,6 +88,35 @@ typedef struct WDS_Data {
 wdsD wds[128880]; // The 128880 WDS stars.
 int wdsIndex[64]; // Index into the wds array.
 
+// The square degree being searched is held in memory. tileOrder lists its
+// stars by declination, so the search can start at the bottom of the
+// candidate's box and stop at its top.
+uData* tile = 0;    // The stars in the current square degree.
+int* tileOrder = 0; // Indices into tile, sorted by declination.
+int tileCap = 0,    // The number of stars tile has room for.
+    tileN = 0;      // The number of stars in tile.
+
+// All of the candidates, in the order mkUCAC4_Regions wrote them.
+cData* can = 0;
+int canN = 0;
+
+// The pairs found are searched for a square degree at a time, but listed in
+// candidate order, as a row per pair.
+typedef struct Row_Data {
+  int can;   // The candidate's place in the candidate list.
+  int at;    // The secondary's place in its square degree.
+  char* str; // The HTML table row.
+} rowD;
+
+rowD* rows = 0;
+int rowCap = 0,
+    rowN = 0;
+
+long zBytes = 0,    // Compressed bytes decoded.
+     zStars = 0;    // Stars decoded from them.
+double zSec = 0;    // CPU seconds spent decoding.
+int zBad = 0;       // Set if a square ran out of bytes while decoding.
+
 int main(int argc, char** argv) {
 
   void r2ra(char*, double ra); // Convert radian ra to hms ra.
@@ -84,44 +127,92 @@ int main(int argc, char** argv) {
             double south,
             double west);
   void readWDS(void);     // Read the coordinates of all precise WDS pairs.
+  void writeHeader(FILE* NEW);          // Start the HTML list.
+  void mergeShards(void);               // Combine all of the shards' pairs.
+  void writeManifest(int cCt, int pCt); // Describe a finished shard.
+  int readManifest(char* mName,         // Look up a value in a manifest.
+                   char* key);
+  void loadTile(char* name);            // Read a square degree into tile.
+  int firstAbove(double dec);           // First star in tile north of dec.
+  int* readCandidates(void);            // Read all the candidates.
+  void addRow(int c, int at, char* str); // Save a table row.
+  void writeRows(FILE* NEW);            // List the rows in candidate order.
 
   time_t start = time(0);
 
-  CAN = fopen("/science/tmp/candidates", "r");
+  if ((argc == 3) && (strcmp(argv[1], "merge") == 0)) {
+    nShards = atoi(argv[2]);
+    mergeShards();
+    exit(0);
+  } else if (argc == 3) {
+    shard = atoi(argv[1]);
+    nShards = atoi(argv[2]);
+    if ((nShards < 1) || (nShards > 99) || (shard < 0) || (shard >= nShards)) {
+      printf("Shard %d of %d makes no sense.\n", shard, nShards);
+      exit(1);
+    }
+    if (nShards > 1) { sprintf(tmpDir, "/science/tmp/shard%02d/", shard); }
+  } else if (argc != 1) {
+    printf("Usage: %s [shard nShards]\n"
+           "       %s merge nShards\n", argv[0], argv[0]);
+    exit(1);
+  }
+
+  // Only search a shard whose regions were finished.
+  if (nShards > 1) {
+    char mName[48];
+    sprintf(mName, "%sregions.manifest", tmpDir);
+    if (readManifest(mName, "complete") != 1) {
+      printf("Shard %d's regions are missing or unfinished.\n", shard);
+      exit(1);
+    }
+
+    // A shard that's run again isn't complete until it writes a new
+    // manifest.
+    sprintf(mName, "%spairs.manifest", tmpDir);
+    remove(mName);
+  }
+
+  char canName[48];
+  sprintf(canName, "%scandidates", tmpDir);
+  CAN = fopen(canName, "r");
   if (CAN == 0) {
     printf("File candidates was not opened!\n");
     exit(0);
   }
 
-  FILE* NEW = fopen("/work/glxy/tmp/unlistedPairs.html", "w");
+  // A shard only saves its table rows. The merge step adds the rest.
+  FILE* NEW;
+  if (nShards > 1) {
+    char partName[64];
+    sprintf(partName, "%sunlistedPairs.part", tmpDir);
+    NEW = fopen(partName, "w");
+  } else {
+    NEW = fopen("/work/glxy/tmp/unlistedPairs.html", "w");
+  }
   if (NEW == 0) {
     printf("File unlistedPairs was not opened!\n");
     exit(0);
   }
-  fprintf(NEW, "\n<!DOCTYPE html PUBLIC Content-type: text/html>\n<HTML>"
-          "<BODY BGCOLOR=navy TEXT=white><CENTER>\n"
-          "<TITLE>Non WDS pairs</TITLE>\n<H2>Non WDS pairs.</H2><BR>\n"
-          "<TABLE BORDER=8><TR><TD>RA Dec</TD><TD>mv</TD><TD>mv src</TD>"
-          "<TD>mvb</TD><TD>mvb src</TD><TD>&rho;\"</TD><TD>Double<BR>Flag</TD>"
-          "<TD>Primary<BR>PM in RA</TD><TD>Primary<BR>PM in Dec</TD>"
-          "<TD>Secondary<BR>PM in RA</TD><TD>Secondary<BR>PM in Dec</TD>"
-          "<TD>A UCAC4 id</TD><TD>B UCAC4 id</TD><TD>Comments</TD></TR>\n");
+  if (nShards == 1) { writeHeader(NEW); }
 
   readWDS(); // Load in the WDS.
 
   // Open and read the candidates list.
-  char sqDeg[24]; // The current square degree being examined.
+  char sqDeg[48] = ""; // The current square degree being examined.
 
   int cCt = 0, // Count the candidates as they're checked.
-      lCt = 1, // Number of lines read from the candidate list of stars.  
       pCt = 0; // Number of unlisted pairs found.
 
   int t = 0; //TEST
 
-  cData cStar; // A candidate star.
-  while (lCt == 1) {
-    lCt = fread(&cStar, sizeof(cData), 1, CAN);
-    if (lCt != 1) { break; }
+  // The candidates are checked a square degree at a time, so each square is
+  // only read once.
+  int* order = readCandidates();
+
+  for (int o = 0; o < canN; o++) {
+    int c = order[o];
+    cData cStar = can[c]; // A candidate star.
 
     if (cStar.mv > mvC) { continue; }
 
@@ -133,25 +224,22 @@ int main(int argc, char** argv) {
 
     int ckLines = 1;  // Number of lines read from a square degree of stars.
 
-    // Open this square if it's not already open.
+    // Load this square if it's not already loaded.
     if (strcmp(cStar.deg, sqDeg) != 0) {
-      if (SQUARE) { fclose(SQUARE); }
-      SQUARE = fopen(cStar.deg, "r");
-      if (SQUARE == NULL) {
-        printf("Failed to open square degree %s.\n", cStar.deg);
-        exit(0);
-      }
+      loadTile(cStar.deg);
       strcpy(sqDeg, cStar.deg);
-
-    } else {
-      rewind(SQUARE); // Start searching at the start of the file.
     }
 
+    // Start searching at the bottom of the box.
+    int k = firstAbove(south);
+
     uData ckSt; // A star to check aganist the candidate star.
     while (ckLines == 1) {
       // Is the star in the box, and is it not the same as the candidate?
-      ckLines = fread(&ckSt, sizeof(uData), 1, SQUARE);
-      if (ckLines != 1) { break; }
+      if (k >= tileN) { break; }
+      int at = tileOrder[k++];
+      ckSt = tile[at];
+      if (ckSt.dec >= north) { break; }
 
       if (ckSt.mv > mvS) { continue; }
 
@@ -207,7 +295,8 @@ int main(int argc, char** argv) {
             char d[16];
             r2dec(d, cStar.dec);
 
-            fprintf(NEW, "<TR><TD>%s %s</TD><TD>%d</TD><TD>%s</TD>" 
+            char row[512];
+            sprintf(row, "<TR><TD>%s %s</TD><TD>%d</TD><TD>%s</TD>" 
             "<TD>%d</TD><TD>%s</TD><TD>%5.2f</TD><TD>%d</TD>" 
             "<TD>%d</TD><TD>%d</TD>" 
             "<TD>%d</TD><TD>%d</TD>" 
@@ -216,6 +305,7 @@ int main(int argc, char** argv) {
             r, d, cStar.mv, cStr, ckSt.mv, ckStr, sep, cStar.dFlg,
             cStar.pmRa, cStar.pmDec, ckSt.pmRa, ckSt.pmDec,
             cStar.zone, cStar.id, ckSt.zone, ckSt.id);
+            addRow(c, at, row);
 
             // printf("%d,%d ", cStar.id, ckSt.id); //TEST
 
@@ -228,10 +318,14 @@ int main(int argc, char** argv) {
     cCt++;
   }
 
-  fprintf(NEW, "\n</BODY></HTML>\n");
+  writeRows(NEW);
+  if (nShards == 1) { fprintf(NEW, "\n</BODY></HTML>\n"); }
   fclose(CAN);
   fclose(NEW);
-  if (SQUARE) { fclose(SQUARE); }
+  free(order);
+  free(can);
+  free(tile);
+  free(tileOrder);
 
   time_t end = time(0);
   int delta = (int) (end - start);
@@ -244,6 +338,467 @@ int main(int argc, char** argv) {
 
   printf("Found %d unlisteds. WdsCt: %d. t: %d. The run took %d:%d:%d.\n",
          (pCt / 2), wdsCt, t, hr, min, sec);
+
+  if (zStars) {
+    printf("Decoded %ld stars from %.1f MB in %.2fs: %.1f MB/s, "
+           "%.1f million stars/s.\n", zStars, zBytes / 1e6, zSec,
+           (zSec > 0 ? zBytes / 1e6 / zSec : 0),
+           (zSec > 0 ? zStars / 1e6 / zSec : 0));
+  }
+
+  // The manifest is written last. If it's there, the shard is complete.
+  if (nShards > 1) { writeManifest(cCt, pCt); }
+}
+
+// Convert UCAC4 right ascension in milliarcseconds to radians. This must
+// match mkUCAC4_Regions exactly.
+double mas2ra(int raMas) {
+  return (double) raMas * pi / (3600000 * 180);
+}
+
+// Convert UCAC4 south polar distance in milliarcseconds to declination in
+// radians. This must match mkUCAC4_Regions exactly.
+double spd2dec(int spdMas) {
+  return (((double) spdMas / 3600000) - 90) * pi / 180;
+}
+
+// Read an unsigned LEB128 varint from *p, stopping at end.
+unsigned int getVarint(unsigned char** p,
+                       unsigned char* end) {
+  unsigned int v = 0;
+  int shift = 0;
+  while (*p < end) {
+    unsigned char b = *(*p)++;
+    v |= (unsigned int) (b & 127) << shift;
+    if (b < 128) { return v; }
+    shift += 7;
+  }
+  zBad = 1;
+  return 0;
+}
+
+// Undo mkUCAC4_Regions' zigzag encoding of a signed value.
+int unzigzag(unsigned int v) {
+  return (int) (v >> 1) ^ -(int) (v & 1);
+}
+
+// Bits still to be read from a packed square degree, low bits first.
+typedef struct Bit_Reader {
+  unsigned char* p;       // The next byte to read.
+  unsigned char* end;     // One past the last byte.
+  unsigned long long acc; // Bits read but not yet used.
+  int n;                  // The number of them.
+} bitR;
+
+// Take the next width bits.
+unsigned int getBits(bitR* r,
+                     int width) {
+  while (r->n < width) {
+    if (r->p < r->end) { r->acc |= (unsigned long long) *r->p++ << r->n; }
+    else { zBad = 1; }
+    r->n += 8;
+  }
+  unsigned int v = (unsigned int) (r->acc & ((1ULL << width) - 1));
+  r->acc >>= width;
+  r->n -= width;
+  return v;
+}
+
+// Make sure tile has room for n stars.
+void growTile(int n) {
+  if (n <= tileCap) { return; }
+  tileCap = n + (n / 2);
+  tile = realloc(tile, tileCap * sizeof(uData));
+  tileOrder = realloc(tileOrder, tileCap * sizeof(int));
+  if ((tile == 0) || (tileOrder == 0)) {
+    printf("Not enough memory for %d stars.\n", n);
+    exit(1);
+  }
+}
+
+// Decode the compressed square degree in buf straight into tile. The layout
+// is described at mkUCAC4_Regions' packTile.
+void unpackTile(char* name,
+                unsigned char* buf,
+                long size) {
+  unsigned char* p = buf + 2;
+  unsigned char* end = buf + size;
+  if ((size < 2) || memcmp(buf, "Z2", 2)) {
+    printf("Square degree %s isn't compressed the way we expect.\n", name);
+    exit(1);
+  }
+
+  zBad = 0;
+  int n = (int) getVarint(&p, end),
+      zoneMin = (int) getVarint(&p, end),
+      raMin = (int) getVarint(&p, end),
+      mvMin = (int) getVarint(&p, end),
+      pmRaMin = unzigzag(getVarint(&p, end)),
+      pmDecMin = unzigzag(getVarint(&p, end));
+  if (zBad || (n < 0) || (n > size * 8)) {
+    printf("Square degree %s is corrupt.\n", name);
+    exit(1);
+  }
+  growTile(n);
+
+  // Column widths, in the order zone, declination, RA, mv, flags, PM in RA,
+  // PM in Dec and zone id.
+  bitR r = { p, end, 0, 0 };
+  int wZone = getBits(&r, 5), wSpd = getBits(&r, 5), wRa = getBits(&r, 5),
+      wMv = getBits(&r, 5), wFlag = getBits(&r, 5), wPmRa = getBits(&r, 5),
+      wPmDec = getBits(&r, 5), wId = getBits(&r, 5);
+
+  for (int i = 0; i < n; i++) {
+    tile[i].zone = zoneMin + (int) getBits(&r, wZone);
+  }
+  for (int i = 0; i < n; i++) {
+    int spd = ((tile[i].zone - 1) * 720000) + (int) getBits(&r, wSpd);
+    tile[i].dec = spd2dec(spd);
+  }
+  for (int i = 0; i < n; i++) {
+    tile[i].ra = mas2ra(raMin + (int) getBits(&r, wRa));
+  }
+  for (int i = 0; i < n; i++) { tile[i].mv = mvMin + (int) getBits(&r, wMv); }
+  for (int i = 0; i < n; i++) {
+    unsigned int f = getBits(&r, wFlag);
+    tile[i].dFlg = (int) (f >> 1);
+    tile[i].mvs = (int) (f & 1);
+  }
+  for (int i = 0; i < n; i++) {
+    tile[i].pmRa = pmRaMin + (int) getBits(&r, wPmRa);
+  }
+  for (int i = 0; i < n; i++) {
+    tile[i].pmDec = pmDecMin + (int) getBits(&r, wPmDec);
+  }
+  for (int i = 0; i < n; i++) { tile[i].id = (int) getBits(&r, wId); }
+
+  // The first star of each zone has its full zone id after the columns. The
+  // rest are deltas from the star before.
+  p = r.p;
+  for (int i = 0; i < n; i++) {
+    if ((i == 0) || (tile[i].zone != tile[i - 1].zone)) {
+      tile[i].id = (int) getVarint(&p, end);
+    } else {
+      tile[i].id += tile[i - 1].id;
+    }
+  }
+
+  if (zBad || (p != end)) {
+    printf("Square degree %s is corrupt.\n", name);
+    exit(1);
+  }
+  tileN = n;
+}
+
+// Sort indices into tile by declination, keeping stars at the same
+// declination in the order they're stored.
+int byDec(const void* a,
+          const void* b) {
+  int ia = *(const int*) a,
+      ib = *(const int*) b;
+  double da = tile[ia].dec,
+         db = tile[ib].dec;
+  if (da != db) { return (da > db) - (da < db); }
+  return (ia > ib) - (ia < ib);
+}
+
+// Read the square degree name into tile. If mkUCAC4_Regions compressed it,
+// it's in name.z instead.
+void loadTile(char* name) {
+  char zName[64];
+  sprintf(zName, "%s.z", name);
+
+  SQUARE = fopen(zName, "r");
+  if (SQUARE) {
+    fseek(SQUARE, 0, SEEK_END);
+    long size = ftell(SQUARE);
+    rewind(SQUARE);
+
+    unsigned char* buf = malloc(size + 1);
+    if ((buf == 0) || (fread(buf, 1, size, SQUARE) != (size_t) size)) {
+      printf("Failed to read square degree %s.\n", zName);
+      exit(0);
+    }
+    fclose(SQUARE);
+
+    clock_t c = clock();
+    unpackTile(zName, buf, size);
+    zSec += (double) (clock() - c) / CLOCKS_PER_SEC;
+    zBytes += size;
+    zStars += tileN;
+    free(buf);
+  } else {
+    SQUARE = fopen(name, "r");
+    if (SQUARE == NULL) {
+      printf("Failed to open square degree %s.\n", name);
+      exit(0);
+    }
+    fseek(SQUARE, 0, SEEK_END);
+    int n = (int) (ftell(SQUARE) / sizeof(uData));
+    rewind(SQUARE);
+
+    growTile(n + 1);
+    tileN = (int) fread(tile, sizeof(uData), n, SQUARE);
+    fclose(SQUARE);
+  }
+
+  for (int i = 0; i < tileN; i++) { tileOrder[i] = i; }
+  qsort(tileOrder, tileN, sizeof(int), byDec);
+}
+
+// Sort indices into the candidate list by square degree, keeping each
+// square's candidates in the order they were listed.
+int bySquare(const void* a,
+             const void* b) {
+  int ia = *(const int*) a,
+      ib = *(const int*) b;
+  int d = strcmp(can[ia].deg, can[ib].deg);
+  if (d) { return d; }
+  return (ia > ib) - (ia < ib);
+}
+
+// Read every candidate in CAN into can. Returns the order to search them in,
+// a square degree at a time.
+int* readCandidates(void) {
+  fseek(CAN, 0, SEEK_END);
+  int max = (int) (ftell(CAN) / sizeof(cData));
+  rewind(CAN);
+
+  can = malloc((max + 1) * sizeof(cData));
+  int* order = malloc((max + 1) * sizeof(int));
+  if ((can == 0) || (order == 0)) {
+    printf("Not enough memory for %d candidates.\n", max);
+    exit(1);
+  }
+  canN = (int) fread(can, sizeof(cData), max, CAN);
+  for (int i = 0; i < canN; i++) { order[i] = i; }
+  qsort(order, canN, sizeof(int), bySquare);
+  return order;
+}
+
+// Save the table row str for candidate c and the secondary at in its square.
+void addRow(int c,
+            int at,
+            char* str) {
+  if (rowN == rowCap) {
+    rowCap = (rowCap * 2) + 1024;
+    rows = realloc(rows, rowCap * sizeof(rowD));
+    if (rows == 0) {
+      printf("Not enough memory for %d pairs.\n", rowCap);
+      exit(1);
+    }
+  }
+  rows[rowN].can = c;
+  rows[rowN].at = at;
+  rows[rowN].str = malloc(strlen(str) + 1);
+  if (rows[rowN].str == 0) {
+    printf("Not enough memory for %d pairs.\n", rowN);
+    exit(1);
+  }
+  strcpy(rows[rowN++].str, str);
+}
+
+// Sort rows by candidate, then by the secondary's place in its square.
+int byCandidate(const void* a,
+                const void* b) {
+  const rowD* ra = a;
+  const rowD* rb = b;
+  if (ra->can != rb->can) { return (ra->can > rb->can) - (ra->can < rb->can); }
+  return (ra->at > rb->at) - (ra->at < rb->at);
+}
+
+// Write the rows in the order the candidates were listed, which runs south
+// to north, the same as searching the candidates one at a time would.
+void writeRows(FILE* NEW) {
+  qsort(rows, rowN, sizeof(rowD), byCandidate);
+  for (int i = 0; i < rowN; i++) {
+    fputs(rows[i].str, NEW);
+    free(rows[i].str);
+  }
+  free(rows);
+}
+
+// Find the first star in the sorted tile north of dec.
+int firstAbove(double dec) {
+  int lo = 0,
+      hi = tileN;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (tile[tileOrder[mid]].dec > dec) { hi = mid; }
+    else { lo = mid + 1; }
+  }
+  return lo;
+}
+
+// Start the HTML list of unlisted pairs.
+void writeHeader(FILE* NEW) {
+  fprintf(NEW, "\n<!DOCTYPE html PUBLIC Content-type: text/html>\n<HTML>"
+          "<BODY BGCOLOR=navy TEXT=white><CENTER>\n"
+          "<TITLE>Non WDS pairs</TITLE>\n<H2>Non WDS pairs.</H2><BR>\n"
+          "<TABLE BORDER=8><TR><TD>RA Dec</TD><TD>mv</TD><TD>mv src</TD>"
+          "<TD>mvb</TD><TD>mvb src</TD><TD>&rho;\"</TD><TD>Double<BR>Flag</TD>"
+          "<TD>Primary<BR>PM in RA</TD><TD>Primary<BR>PM in Dec</TD>"
+          "<TD>Secondary<BR>PM in RA</TD><TD>Secondary<BR>PM in Dec</TD>"
+          "<TD>A UCAC4 id</TD><TD>B UCAC4 id</TD><TD>Comments</TD></TR>\n");
+}
+
+// Describe a finished shard for the merge step.
+void writeManifest(int cCt,
+                   int pCt) {
+  char mName[48];
+  sprintf(mName, "%spairs.manifest", tmpDir);
+  FILE* MAN = fopen(mName, "w");
+  if (MAN == 0) {
+    printf("File %s was not opened!\n", mName);
+    exit(1);
+  }
+  fprintf(MAN, "shard %d\nshards %d\ncandidates %d\npairs %d\ncomplete 1\n",
+          shard, nShards, cCt, pCt);
+  fclose(MAN);
+}
+
+// Look up key in the manifest mName. Returns -99999 if it isn't there.
+int readManifest(char* mName,
+                 char* key) {
+  FILE* MAN = fopen(mName, "r");
+  if (MAN == 0) { return -99999; }
+
+  char k[32];
+  int v;
+  while (fscanf(MAN, "%31s %d", k, &v) == 2) {
+    if (strcmp(k, key) == 0) {
+      fclose(MAN);
+      return v;
+    }
+  }
+  fclose(MAN);
+  return -99999;
+}
+
+// Check that every shard finished, that their declination bands cover the
+// whole sky without overlapping, and combine their pairs into one HTML list.
+// Rows that more than one shard found are only listed once.
+void mergeShards(void) {
+  void writeHeader(FILE* NEW);     // Start the HTML list.
+  unsigned int hashStr(char* str); // Hash a table row.
+
+  if ((nShards < 2) || (nShards > 99)) {
+    printf("Can't merge %d shards.\n", nShards);
+    exit(1);
+  }
+
+  char dir[32],    // A shard's directory.
+       line[1024], // A row of a shard's table.
+       name[64];   // A file in a shard's directory.
+  int decHi = -90, // The northern edge of the previous shard's band.
+      dupCt = 0,   // The number of duplicate rows dropped.
+      pCt = 0,     // The number of rows in the merged list.
+      rowCt = 0;   // The number of rows in all of the shards.
+
+  // Check every shard before writing anything.
+  for (int i = 0; i < nShards; i++) {
+    sprintf(dir, "/science/tmp/shard%02d/", i);
+
+    sprintf(name, "%sregions.manifest", dir);
+    if ((readManifest(name, "complete") != 1) ||
+        (readManifest(name, "shards") != nShards)) {
+      printf("Shard %d's regions are missing or unfinished.\n", i);
+      exit(1);
+    }
+    if (readManifest(name, "decLo") != decHi) {
+      printf("Shard %d doesn't start where shard %d ended.\n", i, i - 1);
+      exit(1);
+    }
+    decHi = readManifest(name, "decHi");
+
+    sprintf(name, "%spairs.manifest", dir);
+    if ((readManifest(name, "complete") != 1) ||
+        (readManifest(name, "shards") != nShards) ||
+        (readManifest(name, "pairs") < 0)) {
+      printf("Shard %d's pairs are missing or unfinished.\n", i);
+      exit(1);
+    }
+    int pairs = readManifest(name, "pairs");
+
+    // A shard that died part way through a re-run can leave an old manifest
+    // behind, so make sure the rows are all there too.
+    sprintf(name, "%sunlistedPairs.part", dir);
+    FILE* PART = fopen(name, "r");
+    if (PART == 0) {
+      printf("File %s was not opened!\n", name);
+      exit(1);
+    }
+    int lineCt = 0; // The number of rows in this shard.
+    while (fgets(line, sizeof(line), PART)) { lineCt++; }
+    fclose(PART);
+    if (lineCt != pairs) {
+      printf("Shard %d has %d rows but its manifest says %d.\n",
+             i, lineCt, pairs);
+      exit(1);
+    }
+    rowCt += pairs;
+  }
+  if (decHi != 91) {
+    printf("The shards stop at %d degrees, not the north pole.\n", decHi);
+    exit(1);
+  }
+
+  // Every row seen so far, in an open addressed hash table that's never more
+  // than half full.
+  int size = 1;
+  while (size < 2 * (rowCt + 1)) { size *= 2; }
+  char** seen = calloc(size, sizeof(char*));
+  if (seen == 0) {
+    printf("Not enough memory to merge %d shards.\n", nShards);
+    exit(1);
+  }
+
+  FILE* NEW = fopen("/work/glxy/tmp/unlistedPairs.html", "w");
+  if (NEW == 0) {
+    printf("File unlistedPairs was not opened!\n");
+    exit(0);
+  }
+  writeHeader(NEW);
+
+  for (int i = 0; i < nShards; i++) {
+    sprintf(dir, "/science/tmp/shard%02d/", i);
+
+    sprintf(name, "%sunlistedPairs.part", dir);
+    FILE* PART = fopen(name, "r");
+    if (PART == 0) {
+      printf("File %s was not opened!\n", name);
+      exit(1);
+    }
+    while (fgets(line, sizeof(line), PART)) {
+      unsigned int h = hashStr(line) & (size - 1);
+      while (seen[h] && strcmp(seen[h], line)) { h = (h + 1) & (size - 1); }
+      if (seen[h]) {
+        dupCt++;
+        continue;
+      }
+      seen[h] = malloc(strlen(line) + 1);
+      strcpy(seen[h], line);
+      fputs(line, NEW);
+      pCt++;
+    }
+    fclose(PART);
+  }
+
+  fprintf(NEW, "\n</BODY></HTML>\n");
+  fclose(NEW);
+
+  for (int i = 0; i < size; i++) { free(seen[i]); }
+  free(seen);
+
+  printf("Merged %d shards. Found %d unlisteds, dropped %d duplicates.\n",
+         nShards, (pCt / 2), dupCt);
+}
+
+// Hash a table row.
+unsigned int hashStr(char* str) {
+  unsigned int h = 5381;
+  while (*str) { h = (h * 33) + (unsigned char) *str++; }
+  return h;
 }
 
 // Check to see if there is a WDS pair within these boundaries.
@@ -1,12 +1,21 @@
 // Read all of the raw UCAC4 data, isolate stars brighter than mvS mv and save
 // these to files each containing about a square degree. Save those brighter
 // than mvC mv to a candidate list of possible double star primaries.
-
+//
+// Usage: mkUCAC4_Regions [-z] [shard nShards]
+// With no arguments the whole sky is written to /science/tmp. Given a shard
+// number and the number of shards, only the square degrees in that shard's
+// declination band are written, to /science/tmp/shardNN/, along with a
+// manifest. Each shard can be run as a separate process or on its own machine.
+// With -z each square degree is compressed when it's complete (see packTile).
+
+#include <dirent.h>
 #include <errno.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 
 // The UCAC4 goes down to 16mv. The fainter you set these limits to, the more
@@ -27,9 +36,31 @@ FILE *CAN,    // The stars that might be a new pair's primary.
 int cCt = 0,    // The number of candidate stars found  
     starCt = 0; // The number of stars brighter than 14mv that are studied.
 
+// Sharded runs split the sky into nShards declination bands. This process
+// only writes square degrees whose declination is in [decLo, decHi). Zones
+// up to two degrees outside the band are read as a halo, so stars near the
+// band's edges still reach the margins of the squares inside it.
+int shard = 0,    // This process' shard, 0 to nShards - 1.
+    nShards = 1,  // The number of shards. 1 is a whole sky run.
+    decLo = -90,  // The southernmost square degree declination written.
+    decHi = 91,   // One past the northernmost square degree declination.
+    zoneLo = 1,   // The first UCAC4 zone read.
+    zoneHi = 900; // The last UCAC4 zone read.
+
+// The holding directory. Shards each get their own subdirectory.
+char tmpDir[32] = "/science/tmp/";
+
+int pack = 0;        // Compress the square degrees when we're done?
+long rawBytes = 0,   // The size of the square degrees before compression,
+     packBytes = 0,  // and after.
+     rawDisk = 0,    // The disk space they took up before compression,
+     packDisk = 0;   // and after. Small files take up a whole block.
+int packCt = 0,      // The number of square degrees compressed.
+    unpackedCt = 0;  // The number that wouldn't compress without loss.
+
 // Store this data from a given UCAC4 entry.
 typedef struct Candidate_Data {
-  char deg[24];// The square degree a candidate is located in.
+  char deg[48];// The square degree a candidate is located in.
   double ra;   // Right ascension in radians.
   double dec;  // Declination in radians.
   int dFlg;    // UCAC4 double flag.
@@ -57,23 +88,49 @@ typedef struct UCAC4_Data {
 
 int main(int argc, char** argv) {
   void openRawData(int i), // Close current raw data file and open a new one.
-       processRawData();   // Read the raw file and convert it to NA format.
+       processRawData(),   // Read the raw file and convert it to NA format.
+       setShard(void),     // Work out this shard's band, zones and directory.
+       writeManifest(int hr, int min, int sec), // Describe a finished shard.
+       packTiles(void);    // Compress all of the square degrees.
   
   time_t start = time(0);
 
+  char* name = argv[0];
+  if ((argc > 1) && (strcmp(argv[1], "-z") == 0)) {
+    pack = 1;
+    argc--;
+    argv++;
+  }
+  if (argc == 3) {
+    shard = atoi(argv[1]);
+    nShards = atoi(argv[2]);
+  } else if (argc != 1) {
+    printf("Usage: %s [-z] [shard nShards]\n", name);
+    exit(1);
+  }
+  setShard();
+
   // This is my holding directory on my machine.  Adjust it to fit your own.
   // The directory must be empty before we begin.
-  system("/bin/rm /science/tmp/*");
+  char cmd[96];
+  if (nShards > 1) {
+    sprintf(cmd, "/bin/mkdir -p %s; /bin/rm -f %s*", tmpDir, tmpDir);
+  } else {
+    sprintf(cmd, "/bin/rm %s*", tmpDir);
+  }
+  system(cmd);
 
   // The primary star candidates are kept here.
-  CAN = fopen("/science/tmp/candidates", "a");
+  char canName[48];
+  sprintf(canName, "%scandidates", tmpDir);
+  CAN = fopen(canName, "a");
   if (CAN == 0) {
     printf("File candidates was not opened!\n");
     exit(0);
   }
 
-  // Parse through all of the stars in the UCAC4.
-  for (int i = 1; i < 901; i++) {
+  // Parse through all of the stars in the UCAC4, or just this shard's zones.
+  for (int i = zoneLo; i <= zoneHi; i++) {
     openRawData(i);
     processRawData(i);
   }
@@ -83,6 +140,10 @@ int main(int argc, char** argv) {
   fclose(RAW);
   if (SQUARE) { fclose(SQUARE); }
 
+  // Square degrees are appended to until the very end, so they can only be
+  // compressed now.
+  if (pack) { packTiles(); }
+
   time_t end = time(0);
   int delta = (int) (end - start);
   int hr = delta / 3600;
@@ -92,6 +153,313 @@ int main(int argc, char** argv) {
          starCt, hr, min, sec);
 
   printf("Found %d candidate stars.\n",cCt); //TEST
+
+  if (pack) {
+    printf("Compressed %d square degrees from %ld to %ld bytes, %.2f to 1. "
+           "%d were left uncompressed.\n", packCt, rawBytes, packBytes,
+           (packBytes ? (double) rawBytes / packBytes : 0), unpackedCt);
+    printf("On disk they went from %ld to %ld bytes, %.2f to 1.\n",
+           rawDisk, packDisk, (packDisk ? (double) rawDisk / packDisk : 0));
+  }
+
+  // The manifest is written last. If it's there, the shard is complete.
+  if (nShards > 1) { writeManifest(hr, min, sec); }
+}
+
+// Work out this shard's declination band, the zones it has to read and
+// where its files go. Square degree declinations run from -90 to 90.
+void setShard(void) {
+  if ((nShards < 1) || (nShards > 99) || (shard < 0) || (shard >= nShards)) {
+    printf("Shard %d of %d makes no sense.\n", shard, nShards);
+    exit(1);
+  }
+  if (nShards == 1) { return; }
+
+  decLo = -90 + ((shard * 181) / nShards);
+  decHi = -90 + (((shard + 1) * 181) / nShards);
+
+  // Square degree d holds stars from d - 1 to d + 1 (see processRawData),
+  // plus the margins of its neighbours. UCAC4 zones are 0.2 degrees wide,
+  // starting at the south pole.
+  zoneLo = (int) ((decLo - 2 + 90) / 0.2) + 1;
+  zoneHi = (int) ((decHi + 1 + 90) / 0.2) + 1;
+  if (zoneLo < 1) { zoneLo = 1; }
+  if (zoneHi > 900) { zoneHi = 900; }
+
+  sprintf(tmpDir, "/science/tmp/shard%02d/", shard);
+}
+
+// Is this square degree's declination inside this shard's band?
+int inBand(int dec) {
+  return (dec >= decLo) && (dec < decHi);
+}
+
+// Describe a finished shard so the merge step can check the bands are all
+// there and don't overlap.
+void writeManifest(int hr, int min, int sec) {
+  char mName[48];
+  sprintf(mName, "%sregions.manifest", tmpDir);
+  FILE* MAN = fopen(mName, "w");
+  if (MAN == 0) {
+    printf("File %s was not opened!\n", mName);
+    exit(1);
+  }
+  fprintf(MAN, "shard %d\nshards %d\ndecLo %d\ndecHi %d\n"
+          "zoneLo %d\nzoneHi %d\nstars %d\ncandidates %d\n"
+          "seconds %d\npacked %d\nrawBytes %ld\npackBytes %ld\n"
+          "rawDisk %ld\npackDisk %ld\ncomplete 1\n",
+          shard, nShards, decLo, decHi, zoneLo, zoneHi, starCt, cCt,
+          (hr * 3600) + (min * 60) + sec, pack, rawBytes, packBytes,
+          rawDisk, packDisk);
+  fclose(MAN);
+}
+
+// Convert UCAC4 right ascension in milliarcseconds to radians.
+double mas2ra(int raMas) {
+  return (double) raMas * pi / (3600000 * 180);
+}
+
+// Convert UCAC4 south polar distance in milliarcseconds to declination in
+// radians.
+double spd2dec(int spdMas) {
+  return (((double) spdMas / 3600000) - 90) * pi / 180;
+}
+
+// Append v to buf as an unsigned LEB128 varint: seven bits a byte, low bits
+// first, the high bit set on all but the last byte.
+unsigned char* putVarint(unsigned char* buf,
+                         unsigned int v) {
+  while (v > 127) {
+    *buf++ = (unsigned char) ((v & 127) | 128);
+    v >>= 7;
+  }
+  *buf++ = (unsigned char) v;
+  return buf;
+}
+
+// Map small signed values to small unsigned ones: 0, -1, 1, -2 ... become
+// 0, 1, 2, 3 ...
+unsigned int zigzag(int v) {
+  return ((unsigned int) v << 1) ^ (unsigned int) (v >> 31);
+}
+
+// The number of bits needed to hold v.
+int bitWidth(unsigned int v) {
+  int w = 0;
+  while (v) {
+    w++;
+    v >>= 1;
+  }
+  return w;
+}
+
+// Bits waiting to be written to a packed square degree, low bits first.
+typedef struct Bit_Writer {
+  unsigned char* b;       // Where the next whole byte goes.
+  unsigned long long acc; // Bits not yet written.
+  int n;                  // The number of them.
+} bitW;
+
+// Append the low width bits of v.
+void putBits(bitW* w,
+             unsigned int v,
+             int width) {
+  w->acc |= (unsigned long long) v << w->n;
+  w->n += width;
+  while (w->n >= 8) {
+    *w->b++ = (unsigned char) w->acc;
+    w->acc >>= 8;
+    w->n -= 8;
+  }
+}
+
+// The disk space the file name takes up, in whole blocks.
+long diskBytes(char* name) {
+  struct stat s;
+  if (stat(name, &s)) { return 0; }
+  return (long) s.st_blocks * 512;
+}
+
+// Sort square degree stars by zone, then by zone id.
+int byZoneId(const void* a,
+             const void* b) {
+  const uData* sa = a;
+  const uData* sb = b;
+  if (sa->zone != sb->zone) {
+    return (sa->zone > sb->zone) - (sa->zone < sb->zone);
+  }
+  return (sa->id > sb->id) - (sa->id < sb->id);
+}
+
+// The columns of a packed square degree, in the order they're stored.
+enum { cZone, cSpd, cRa, cMv, cFlag, cPmRa, cPmDec, cId, nCols };
+
+// Compress the square degree rawName to rawName.z and remove the original.
+// The stars are sorted by zone and zone id, which puts each zone's stars in
+// order of RA. Every column is then bit packed, each with the fewest bits
+// that hold its largest value in this square:
+//   zone less the minimum zone,
+//   south polar distance in mas from the south edge of the star's zone,
+//   RA in mas less the minimum,
+//   mv less the minimum,
+//   double flag * 2 + mv source,
+//   PM in RA and in Dec less their minimums,
+//   zone id less the previous star's, 0 for the first star of a zone.
+// The file is "Z2", varints for the number of stars and the minimum zone, RA,
+// mv and zigzag PMs, eight 5 bit column widths and the columns, then a varint
+// zone id for the first star of each zone.
+// RA and Dec are kept as the UCAC4's integer mas, so the radians that
+// findUnlistedDoubles gets back are exactly the ones written here. A square
+// degree that won't come back exactly is left as it is.
+void packTile(char* rawName) {
+  FILE* RAWT = fopen(rawName, "r");
+  if (RAWT == 0) {
+    printf("Couldn't open %s because\n  %s.\n", rawName, strerror(errno));
+    exit(1);
+  }
+  fseek(RAWT, 0, SEEK_END);
+  long size = ftell(RAWT);
+  rewind(RAWT);
+
+  int n = (int) (size / sizeof(uData));
+  uData* st = malloc((n + 1) * sizeof(uData));
+  unsigned int* col = malloc((n + 1) * nCols * sizeof(unsigned int));
+  unsigned char* buf = malloc((n * 48) + 64); // Far more than we'll need.
+  if ((st == 0) || (col == 0) || (buf == 0)) {
+    printf("Not enough memory to compress %s.\n", rawName);
+    exit(1);
+  }
+  n = (int) fread(st, sizeof(uData), n, RAWT);
+  fclose(RAWT);
+
+  qsort(st, n, sizeof(uData), byZoneId);
+
+  int exact = 1,
+      raMin = 0x7fffffff,
+      mvMin = 0x7fffffff,
+      pmRaMin = 0x7fffffff,
+      pmDecMin = 0x7fffffff,
+      zoneMin = 0x7fffffff;
+  for (int i = 0; i < n; i++) {
+    int ra = (int) lround(st[i].ra * (3600000 * 180) / pi),
+        spd = (int) lround(((st[i].dec * 180 / pi) + 90) * 3600000),
+        zoneSpd = (st[i].zone - 1) * 720000; // Zones are 0.2 degrees.
+    if ((mas2ra(ra) != st[i].ra) || (spd2dec(spd) != st[i].dec) ||
+        (ra < 0) || (spd < zoneSpd) || (st[i].zone < 1) ||
+        (st[i].mv < 0) || (st[i].dFlg < 0) || (st[i].id < 0) ||
+        (st[i].mvs & ~1)) {
+      exact = 0;
+    }
+    col[(cRa * n) + i] = ra;
+    col[(cSpd * n) + i] = spd - zoneSpd;
+    if (ra < raMin) { raMin = ra; }
+    if (st[i].mv < mvMin) { mvMin = st[i].mv; }
+    if (st[i].pmRa < pmRaMin) { pmRaMin = st[i].pmRa; }
+    if (st[i].pmDec < pmDecMin) { pmDecMin = st[i].pmDec; }
+    if (st[i].zone < zoneMin) { zoneMin = st[i].zone; }
+  }
+
+  if (exact && (n > 0)) {
+    int width[nCols] = { 0 };
+    for (int i = 0; i < n; i++) {
+      col[(cZone * n) + i] = st[i].zone - zoneMin;
+      col[(cRa * n) + i] -= raMin;
+      col[(cMv * n) + i] = st[i].mv - mvMin;
+      col[(cFlag * n) + i] = (st[i].dFlg << 1) | st[i].mvs;
+      col[(cPmRa * n) + i] = st[i].pmRa - pmRaMin;
+      col[(cPmDec * n) + i] = st[i].pmDec - pmDecMin;
+      col[(cId * n) + i] = ((i > 0) && (st[i].zone == st[i - 1].zone)) ?
+                           st[i].id - st[i - 1].id : 0;
+      for (int c = 0; c < nCols; c++) {
+        int w = bitWidth(col[(c * n) + i]);
+        if (w > width[c]) { width[c] = w; }
+      }
+    }
+
+    unsigned char* b = buf;
+    memcpy(b, "Z2", 2);
+    b += 2;
+    b = putVarint(b, n);
+    b = putVarint(b, zoneMin);
+    b = putVarint(b, raMin);
+    b = putVarint(b, mvMin);
+    b = putVarint(b, zigzag(pmRaMin));
+    b = putVarint(b, zigzag(pmDecMin));
+
+    bitW w = { b, 0, 0 };
+    for (int c = 0; c < nCols; c++) { putBits(&w, width[c], 5); }
+    for (int c = 0; c < nCols; c++) {
+      for (int i = 0; i < n; i++) { putBits(&w, col[(c * n) + i], width[c]); }
+    }
+    putBits(&w, 0, 7); // Flush the last partial byte.
+    b = w.b;
+
+    for (int i = 0; i < n; i++) {
+      if ((i == 0) || (st[i].zone != st[i - 1].zone)) {
+        b = putVarint(b, st[i].id);
+      }
+    }
+
+    char zName[296];
+    sprintf(zName, "%s.z", rawName);
+    FILE* PACK = fopen(zName, "w");
+    if ((PACK == 0) || (fwrite(buf, b - buf, 1, PACK) != 1) || fclose(PACK)) {
+      printf("Couldn't write %s because\n  %s.\n", zName, strerror(errno));
+      exit(1);
+    }
+    long disk = diskBytes(rawName);
+    remove(rawName);
+
+    rawBytes += size;
+    packBytes += b - buf;
+    rawDisk += disk;
+    packDisk += diskBytes(zName);
+    packCt++;
+  } else {
+    long disk = diskBytes(rawName);
+    rawBytes += size;
+    packBytes += size;
+    rawDisk += disk;
+    packDisk += disk;
+    unpackedCt++;
+  }
+
+  free(st);
+  free(col);
+  free(buf);
+}
+
+// Compress every square degree in the holding directory.
+void packTiles(void) {
+  DIR* TMP = opendir(tmpDir);
+  if (TMP == 0) {
+    printf("Couldn't open %s because\n  %s.\n", tmpDir, strerror(errno));
+    exit(1);
+  }
+
+  char rawName[288];
+  struct dirent* f;
+  while ((f = readdir(TMP))) {
+    // Square degrees are named f<ra>_s<dec>.
+    if ((f->d_name[0] != 'f') || strchr(f->d_name, '.')) { continue; }
+    sprintf(rawName, "%s%s", tmpDir, f->d_name);
+    packTile(rawName);
+  }
+  closedir(TMP);
+}
+
+// Add a star near a square degree's boundary to the neighbouring square
+// r, s, as long as that square belongs to this shard.
+void saveMargin(int r,
+                int s,
+                uData* star) {
+  if (! inBand(s - 89)) { return; }
+
+  char str[48];
+  sprintf(str, "%sf%d_s%d", tmpDir, r, s);
+  MGN = fopen(str, "a");
+  fwrite(star, sizeof(uData), 1, MGN);
+  fclose(MGN);
 }
 
 // Close current raw data file and open a new one.
@@ -120,8 +488,7 @@ void openRawData(int i) {
 // Read the raw file and convert it to an ASCII format.
 // RA and dec are converted to in radians.
 void processRawData(int zone) {
-  char str[24];     // Generic string.
-  char sqDeg[24];   // Name of a square degree zone file.
+  char sqDeg[48];   // Name of a square degree zone file.
   int curDec = -99999,
       numLines = 1,
       curRa = -99999,
@@ -141,14 +508,13 @@ void processRawData(int zone) {
     }
 
     if (mv > mvS) { continue; } // Stars must be brighter than 14mv.
-    starCt++;
 
     // Convert milliarcseconds to radians.
-    double raMas = (double) ((d[3] << 24) + (d[2] << 16) + (d[1] << 8) + d[0]);
-    double raRad = (double) raMas * pi / (3600000 * 180);
+    int raMas = (d[3] << 24) + (d[2] << 16) + (d[1] << 8) + d[0];
+    double raRad = mas2ra(raMas);
 
-    double decMas = (double) ((d[7] << 24) +(d[6] << 16) + (d[5] << 8) + d[4]);
-    double decRad = (((double) decMas / 3600000) - 90) * pi / 180;
+    int decMas = (d[7] << 24) +(d[6] << 16) + (d[5] << 8) + d[4];
+    double decRad = spd2dec(decMas);
 
     // These "coordinates" identify the file to store the star in.
     // They are in units of integer degrees.
@@ -170,80 +536,64 @@ void processRawData(int zone) {
     uStar.zone = zone;
     uStar.id = sCt;
 
-    if ((curRa != ra) || (curDec != dec)) {
-      if (SQUARE) { fclose(SQUARE); }
-      sprintf(sqDeg, "/science/tmp/f%d_s%d", ra, (dec + 89));
-      SQUARE = fopen(sqDeg, "a");
-      curRa = ra;
-      curDec = dec;
-    }
+    // Halo stars outside this shard's band only go to the margins.
+    if (inBand(dec)) {
+      starCt++;
+
+      if ((curRa != ra) || (curDec != dec)) {
+        if (SQUARE) { fclose(SQUARE); }
+        sprintf(sqDeg, "%sf%d_s%d", tmpDir, ra, (dec + 89));
+        SQUARE = fopen(sqDeg, "a");
+        curRa = ra;
+        curDec = dec;
+      }
 
-    fwrite(&uStar, sizeof(uStar), 1, SQUARE);
-
-    if (mv < mvC) {
-      // This is a candidate star.
-      cData cStar;
-      strcpy(cStar.deg, sqDeg);
-      cStar.ra = raRad;
-      cStar.dec = decRad;
-      cStar.mv = mv;
-      cStar.mvs = mvSource;
-      cStar.pmRa = uStar.pmRa;
-      cStar.pmDec = uStar.pmDec;
-      cStar.dFlg = d[14];
-      cStar.zone = zone;
-      cStar.id = sCt;
-      fwrite(&cStar, sizeof(cStar), 1, CAN);
-      cCt++;
+      fwrite(&uStar, sizeof(uStar), 1, SQUARE);
+
+      if (mv < mvC) {
+        // This is a candidate star.
+        cData cStar;
+        strcpy(cStar.deg, sqDeg);
+        cStar.ra = raRad;
+        cStar.dec = decRad;
+        cStar.mv = mv;
+        cStar.mvs = mvSource;
+        cStar.pmRa = uStar.pmRa;
+        cStar.pmDec = uStar.pmDec;
+        cStar.dFlg = d[14];
+        cStar.zone = zone;
+        cStar.id = sCt;
+        fwrite(&cStar, sizeof(cStar), 1, CAN);
+        cCt++;
+      }
     }
 
     // About three percent of the stars will be so close to the edge of a
     // file's boundary, they will need to be in the other file as well.
-    double delta = fabs(decDeg - (double) dec);
-    if (delta < margin) { // Check the southern boundary.
-      double sDec = decDeg - 1;
-      if (sDec > -90) {
-        sDec *= pi / 180;
-        // These "coordinates" again identify the file to store the star in.
-        int r = (int) (raDeg * cos(sDec));
-        int d = (int) (sDec * 180 / pi) + 89;
-        sprintf(str, "/science/tmp/f%d_s%d", r, d);
-        MGN = fopen(str, "a");
-        fwrite(&uStar, sizeof(uStar), 1, MGN);
-        fclose(MGN);
-      }
-    } else if (delta > (1 - margin)) { // Check the northern boundary.
-      double sDec = decRad + 1;
-      if (sDec < 90) {
-        sDec *= pi / 180;
-        // These "coordinates" again identify the file to store the star in.
-        int r = (int) (raDeg * cos(sDec));
-        int d = (int) (sDec * 180 / pi) + 89;
-        sprintf(str, "/science/tmp/f%d_s%d", r, d);
-        MGN = fopen(str, "a");
-        fwrite(&uStar, sizeof(uStar), 1, MGN);
-        fclose(MGN);
-      }
+    // Square dec holds [dec, dec + 1) north of the equator, (dec - 1, dec]
+    // south of it and (-1, 1) for 0, so its edges depend on the sign. Its
+    // neighbours are always dec - 1 and dec + 1, in the same RA column.
+    double mDeg = margin * 180 / pi, // The margin in degrees.
+           sEdge = (dec > 0) ? dec : dec - 1,
+           nEdge = (dec < 0) ? dec : dec + 1;
+    if (((decDeg - sEdge) < mDeg) && (dec > -90)) {
+      saveMargin(ra, (dec - 1 + 89), &uStar); // Over the southern boundary.
+    } else if (((nEdge - decDeg) < mDeg) && (dec < 90)) {
+      saveMargin(ra, (dec + 1 + 89), &uStar); // Over the northern boundary.
     }
 
-    delta = fabs(raDeg - (double) ra);
+    double delta = fabs(raDeg - (double) ra);
     if (delta < margin) {               // Check the western boundary.
       double sRa = raDeg - 1;
       if (sRa > 0) {
         // These "coordinates" again identify the file to store the star in.
         int r = (int) (sRa * cos(decRad));
-        sprintf(str, "/science/tmp/f%d_s%d", r, (dec + 89));
-        MGN = fopen(str, "a");
-        fwrite(&uStar, sizeof(uStar), 1, MGN);
-        fclose(MGN);
+        saveMargin(r, (dec + 89), &uStar);
       } else {
         sRa = sRa + 360;
         // These "coordinates" again identify the file to store the star in.
         int r = (int) (sRa * cos(decRad));
-        sprintf(str, "/science/tmp/f%d_s%d", r, (dec + 89));
-        MGN = fopen(str, "a");
-        fwrite(&uStar, sizeof(uStar), 1, MGN);
-        fclose(MGN);
+        saveMargin(r, (dec + 89), &uStar);
       }
     } else if (delta > (1 - margin)) {  // Check the eastern boundary.
       double sRa = raDeg + 1;
@@ -251,18 +601,12 @@ void processRawData(int zone) {
         sRa *= pi / 180;
         // These "coordinates" again identify the file to store the star in.
         int r = (int) (sRa * cos(decRad));
-        sprintf(str, "/science/tmp/f%d_s%d", r, (dec + 89));
-        MGN = fopen(str, "a");
-        fwrite(&uStar, sizeof(uStar), 1, MGN);
-        fclose(MGN);
+        saveMargin(r, (dec + 89), &uStar);
       } else {
         sRa = (sRa - 360) * (pi / 180);
         // These "coordinates" again identify the file to store the star in.
         int r = (int) (sRa * cos(decRad));
-        sprintf(str, "/science/tmp/f%d_s%d", r, (dec + 89));
-        MGN = fopen(str, "a");
-        fwrite(&uStar, sizeof(uStar), 1, MGN);
-        fclose(MGN);
+        saveMargin(r, (dec + 89), &uStar);
       }
     }
     sCt++;